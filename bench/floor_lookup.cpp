@@ -0,0 +1,134 @@
+// Native benchmark of finding a collection's floor listing in asks.
+//
+// scan:  what a front end had to do before the bycollprice index, walk every ask and resolve its
+//        first dgood to dgoodstats to learn the collection
+// index: lower_bound on category_name_id << 64 in an ordered index keyed like
+//        asks::get_collection_price, the first row is the floor
+//
+// Tables are modelled with ordered std containers, the native stand in for multi_index. Timings
+// are host timings, useful for comparing the two lookups, not for estimating on chain cost.
+//
+// build and run with `make bench`
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+typedef unsigned __int128 uint128_t;
+
+struct ask {
+    uint64_t batch_id;
+    vector<uint64_t> dgood_ids;
+    int64_t amount;
+    uint64_t category_name_id;
+};
+
+struct dgood {
+    uint64_t category;
+    uint64_t token_name;
+};
+
+// same key as asks::get_collection_price
+static uint128_t collection_price( uint64_t category_name_id, int64_t amount ) {
+    return ( static_cast<uint128_t>( category_name_id ) << 64 ) | static_cast<uint64_t>( amount );
+}
+
+struct tables {
+    map<uint64_t, ask> asks;
+    map<uint64_t, dgood> dgoods;
+    map<pair<uint64_t, uint64_t>, uint64_t> stats;
+    multimap<uint128_t, uint64_t> bycollprice;
+};
+
+static tables make_tables( size_t ask_count, uint64_t collections, uint64_t seed ) {
+    tables t;
+    mt19937_64 rng( seed );
+    vector<uint64_t> serials( collections + 1, 0 );
+    for ( uint64_t c = 1; c <= collections; c++ ) {
+        t.stats[make_pair( c, c )] = c;
+    }
+    for ( size_t i = 0; i < ask_count; i++ ) {
+        uint64_t cid = 1 + rng() % collections;
+        uint64_t batch = 1 + rng() % 3;
+        ask a;
+        a.amount = 201 + static_cast<int64_t>( rng() % 10000000 );
+        a.category_name_id = cid;
+        for ( uint64_t b = 0; b < batch; b++ ) {
+            uint64_t id = ( cid << 32 ) | ++serials[cid];
+            t.dgoods[id] = dgood{ cid, cid };
+            a.dgood_ids.push_back( id );
+        }
+        a.batch_id = a.dgood_ids[0];
+        t.bycollprice.emplace( collection_price( cid, a.amount ), a.batch_id );
+        t.asks.emplace( a.batch_id, a );
+    }
+    return t;
+}
+
+static uint64_t floor_scan( const tables& t, uint64_t category_name_id ) {
+    uint64_t floor_batch = 0;
+    int64_t floor_amount = 0;
+    for ( auto const& entry: t.asks ) {
+        auto const& a = entry.second;
+        auto const& dg = t.dgoods.at( a.dgood_ids[0] );
+        if ( t.stats.at( make_pair( dg.category, dg.token_name ) ) != category_name_id ) {
+            continue;
+        }
+        if ( floor_batch == 0 || a.amount < floor_amount ) {
+            floor_batch = a.batch_id;
+            floor_amount = a.amount;
+        }
+    }
+    return floor_batch;
+}
+
+static uint64_t floor_index( const tables& t, uint64_t category_name_id ) {
+    auto itr = t.bycollprice.lower_bound( static_cast<uint128_t>( category_name_id ) << 64 );
+    if ( itr == t.bycollprice.end() || static_cast<uint64_t>( itr->first >> 64 ) != category_name_id ) {
+        return 0;
+    }
+    return itr->second;
+}
+
+template<typename F>
+static double ns_per_lookup( const tables& t, uint64_t collections, size_t lookups, F&& f ) {
+    volatile uint64_t sink = 0;
+    auto start = chrono::steady_clock::now();
+    for ( size_t i = 0; i < lookups; i++ ) {
+        sink = sink + f( t, 1 + i % collections );
+    }
+    auto elapsed = chrono::steady_clock::now() - start;
+    return chrono::duration<double, nano>( elapsed ).count() / lookups;
+}
+
+int main() {
+    const uint64_t collections = 50;
+    printf( "%10s %14s %14s %10s\n", "asks", "scan ns", "index ns", "speedup" );
+    for ( size_t ask_count: { 1000, 10000, 100000 } ) {
+        auto t = make_tables( ask_count, collections, ask_count );
+
+        // both lookups must agree on every collection's floor, compared by price since listings
+        // with equal prices may resolve to different batches
+        for ( uint64_t c = 1; c <= collections; c++ ) {
+            uint64_t scanned = floor_scan( t, c );
+            uint64_t indexed = floor_index( t, c );
+            if ( t.asks.at( scanned ).amount != t.asks.at( indexed ).amount ) {
+                fprintf( stderr, "floor mismatch for collection %llu\n", static_cast<unsigned long long>( c ) );
+                return EXIT_FAILURE;
+            }
+        }
+
+        size_t scan_lookups = ask_count >= 100000 ? 20 : 200;
+        double scan_ns = ns_per_lookup( t, collections, scan_lookups, floor_scan );
+        double index_ns = ns_per_lookup( t, collections, 200000, floor_index );
+        printf( "%10zu %14.0f %14.0f %9.0fx\n", ask_count, scan_ns, index_ns, scan_ns / index_ns );
+    }
+    return EXIT_SUCCESS;
+}
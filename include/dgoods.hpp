@@ -5,19 +5,55 @@
 #include <eosio/eosio.hpp>
 #include <eosio/time.hpp>
 #include <eosio/singleton.hpp>
+#include <eosio/binary_extension.hpp>
+#include <limits>
 #include <string>
 #include <vector>
 
 #include "utility.hpp"
+#include "instrument.hpp"
 
 using namespace std;
 using namespace eosio;
 using namespace utility;
 
+// contiguous run of dgood_ids, start_id through start_id + count - 1
+struct idrange {
+    uint64_t start_id;
+    uint64_t count;
+
+    EOSLIB_SERIALIZE( idrange, (start_id)(count) )
+};
+
+// one entry of a multi type fungible transfer
+struct ftquantity {
+    name category;
+    name token_name;
+    asset quantity;
+
+    EOSLIB_SERIALIZE( ftquantity, (category)(token_name)(quantity) )
+};
+
+// one listing bought in a cart, logged by logcartsale
+struct cartlisting {
+    uint64_t batch_id;
+    name seller;
+    asset amount;
+    vector<idrange> dgood_ranges;
+
+    EOSLIB_SERIALIZE( cartlisting, (batch_id)(seller)(amount)(dgood_ranges) )
+};
+
 CONTRACT dgoods: public contract {
     public:
         using contract::contract;
 
+        // dgood_id layout: category_name_id << SERIAL_NUMBER_BITS | serial_number
+        static constexpr uint64_t SERIAL_NUMBER_BITS = 32;
+        static constexpr uint64_t MAX_SERIAL_NUMBER = ( 1ULL << SERIAL_NUMBER_BITS ) - 1;
+        // keeps dgood_id below 2^53 so it survives javascript number conversion
+        static constexpr uint64_t MAX_CATEGORY_NAME_ID = ( 1ULL << 21 ) - 1;
+
         dgoods(name receiver, name code, datastream<const char*> ds)
             : contract(receiver, code, ds) {}
 
@@ -47,7 +83,8 @@ CONTRACT dgoods: public contract {
         ACTION freezemaxsup( const name& category, const name& token_name );
 
         ACTION burnnft(const name& owner,
-                       const vector<uint64_t>& dgood_ids);
+                       const vector<uint64_t>& dgood_ids,
+                       const binary_extension<vector<idrange>>& dgood_ranges);
 
         ACTION burnft(const name& owner,
                       const uint64_t& category_name_id,
@@ -58,7 +95,8 @@ CONTRACT dgoods: public contract {
         ACTION transfernft(const name& from,
                            const name& to,
                            const vector<uint64_t>& dgood_ids,
-                           const string& memo);
+                           const string& memo,
+                           const binary_extension<vector<idrange>>& dgood_ranges);
 
         ACTION transferft(const name& from,
                           const name& to,
@@ -67,14 +105,24 @@ CONTRACT dgoods: public contract {
                           const asset& quantity,
                           const string& memo);
 
+        ACTION transferfts(const name& from,
+                           const name& to,
+                           const vector<ftquantity>& transfers,
+                           const string& memo);
+
         ACTION listsalenft(const name& seller,
                            const vector<uint64_t>& dgood_ids,
                            const uint32_t sell_by_days,
-                           const asset& net_sale_amount);
+                           const asset& net_sale_amount,
+                           const binary_extension<vector<idrange>>& dgood_ranges);
 
         ACTION closesalenft(const name& seller,
                             const uint64_t& batch_id);
 
+        ACTION withdraw(const name& rev_partner);
+
+        ACTION setroyflush(const asset& flush_threshold);
+
         ACTION logcall(const uint64_t& dgood_id);
 
         ACTION logsale(const vector<uint64_t>& dgood_ids,
@@ -82,6 +130,10 @@ CONTRACT dgoods: public contract {
                        const name& buyer,
                        const name& receiver);
 
+        ACTION logcartsale(const vector<cartlisting>& listings,
+                           const name& buyer,
+                           const name& receiver);
+
 
         TABLE lockednfts {
             uint64_t dgood_id;
@@ -97,19 +149,46 @@ CONTRACT dgoods: public contract {
             name seller;
             asset amount;
             time_point_sec expiration;
+            // 0 if the listing holds dgoods from more than one collection, binary extension so asks
+            // listed before it was added still deserialize
+            binary_extension<uint64_t> category_name_id;
+            // dgoods in the listing, asks listed before this was added only have dgood_ids
+            binary_extension<vector<idrange>> dgood_ranges;
 
             uint64_t primary_key() const { return batch_id; }
             uint64_t get_seller() const { return seller.value; }
+            // collection in the high 64 bits and price in the low, lower_bound on
+            // category_name_id << 64 gives the floor listing of that collection
+            uint128_t get_collection_price() const {
+                return ( static_cast<uint128_t>( category_name_id.value_or( 0 ) ) << 64 ) | static_cast<uint64_t>( amount.amount );
+            }
         };
 
+        // binary extensions must stay last so rows written before they were added still read
+        EOSLIB_SERIALIZE( asks, (batch_id)(dgood_ids)(seller)(amount)(expiration)(category_name_id)(dgood_ranges) )
+
         TABLE tokenconfigs {
             name standard;
             string version;
             symbol_code symbol;
             uint64_t category_name_id;
+            // no longer advanced, dgood_id is derived per collection, see _dgoodid
             uint64_t next_dgood_id;
         };
 
+        // scope is self, auto flush threshold for the royalties ledger
+        TABLE royaltyconf {
+            asset flush_threshold;
+        };
+
+        // scope is self, rev_partner fees from sales waiting to be withdrawn
+        TABLE royalties {
+            name rev_partner;
+            asset balance;
+
+            uint64_t primary_key() const { return rev_partner.value; }
+        };
+
         TABLE categoryinfo {
             name category;
 
@@ -163,30 +242,69 @@ CONTRACT dgoods: public contract {
             uint64_t primary_key() const { return category_name_id; }
         };
 
-        using config_index = singleton< "tokenconfigs"_n, tokenconfigs >;
+#ifdef DGOODS_INSTRUMENT
+        // scope is action name, only present in instrumented builds
+        TABLE dbopstats {
+            name     table;
+            uint64_t calls;
+            uint64_t finds;
+            uint64_t gets;
+            uint64_t emplaces;
+            uint64_t modifies;
+            uint64_t erases;
+            uint64_t bytes;
+
+            uint64_t primary_key() const { return table.value; }
+        };
 
-        using account_index = multi_index< "accounts"_n, accounts >;
+        using opstats_index = multi_index< "dbopstats"_n, dbopstats >;
 
-        using category_index = multi_index< "categoryinfo"_n, categoryinfo>;
+        void logopstats(const name& action);
+#endif
 
-        using stats_index = multi_index< "dgoodstats"_n, dgoodstats>;
+        using config_index = instrument::singleton< "tokenconfigs"_n, tokenconfigs >;
 
-        using dgood_index = multi_index< "dgood"_n, dgood,
+        using account_index = instrument::table< "accounts"_n, accounts >;
+
+        using category_index = instrument::table< "categoryinfo"_n, categoryinfo>;
+
+        using stats_index = instrument::table< "dgoodstats"_n, dgoodstats>;
+
+        using dgood_index = instrument::table< "dgood"_n, dgood,
             indexed_by< "byowner"_n, const_mem_fun< dgood, uint64_t, &dgood::get_owner> > >;
 
-        using ask_index = multi_index< "asks"_n, asks,
-            indexed_by< "byseller"_n, const_mem_fun< asks, uint64_t, &asks::get_seller> > >;
+        using ask_index = instrument::table< "asks"_n, asks,
+            indexed_by< "byseller"_n, const_mem_fun< asks, uint64_t, &asks::get_seller> >,
+            indexed_by< "bycollprice"_n, const_mem_fun< asks, uint128_t, &asks::get_collection_price> > >;
+
+        using lock_index = instrument::table< "lockednfts"_n, lockednfts>;
 
-        using lock_index = multi_index< "lockednfts"_n, lockednfts>;
+        using royaltyconf_index = instrument::singleton< "royaltyconf"_n, royaltyconf >;
+
+        using royalty_index = instrument::table< "royalties"_n, royalties>;
+
+        // dgoodstats read during a batch, keyed by category, token_name
+        using stats_cache = map< pair<uint64_t, uint64_t>, dgoodstats >;
 
       private:
-        map<name, asset> _calcfees(vector<uint64_t> dgood_ids, asset ask_amount, name seller);
-        void _changeowner( const name& from, const name& to, const vector<uint64_t>& dgood_ids, const string& memo, const bool& istransfer);
+        map<name, asset> _calcfees(const vector<idrange>& dgood_ranges, asset ask_amount, name seller);
+        void _creditroyalty(const name& rev_partner, const asset& amount, const asset& flush_threshold);
+        void _sendeos(const name& to, const asset& amount, const string& memo);
+        void _changeowner( const name& from, const name& to, const vector<idrange>& dgood_ranges, const string& memo, const bool& istransfer);
+        vector<idrange> _mergeranges(const vector<uint64_t>& dgood_ids, const vector<idrange>& dgood_ranges);
+        void _checkunlocked(lock_index& lock_table, const idrange& range, const char* error_msg);
+        void _unlock(lock_index& lock_table, const vector<idrange>& dgood_ranges);
+        const dgoodstats& _getstats(stats_cache& stats, const name& category, const name& token_name);
+        template<typename F>
+        void _walkdgoods(dgood_index& dgood_table, const vector<idrange>& dgood_ranges, F&& f);
         void _checkasset( const asset& amount, const bool& fungible );
         void _mint(const name& to, const name& issuer, const name& category, const name& token_name,
-                  const asset& issued_supply, const string& relative_uri);
-        uint64_t _nextdgoodid();
+                  const uint64_t& category_name_id, const asset& issued_supply, const string& relative_uri);
+        uint64_t _dgoodid(const uint64_t& category_name_id, const uint64_t& serial_number);
         void _add_balance(const name& owner, const name& issuer, const name& category, const name& token_name,
                          const uint64_t& category_name_id, const asset& quantity);
+        void _add_balance(account_index& to_account, const name& ram_payer, const name& category, const name& token_name,
+                         const uint64_t& category_name_id, const asset& quantity);
         void _sub_balance(const name& owner, const uint64_t& category_name_id, const asset& quantity);
+        void _sub_balance(account_index& from_account, const accounts& acct, const asset& quantity);
 };
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <map>
+#include <eosio/eosio.hpp>
+#include <eosio/multi_index.hpp>
+#include <eosio/singleton.hpp>
+
+using namespace std;
+using namespace eosio;
+
+// Table access used by the contract goes through instrument::table and instrument::singleton.
+// In a normal build these are plain multi_index / singleton aliases and cost nothing. When built
+// with DGOODS_INSTRUMENT every find, get, emplace, modify and erase is counted per table, along
+// with the bytes serialized on writes, and flushed to the dbopstats table at the end of the action.
+// Rows reached by walking an iterator are reported with instrument::walked and counted as finds.
+namespace instrument {
+
+#ifdef DGOODS_INSTRUMENT
+
+    struct op_counts {
+        uint64_t finds    = 0;
+        uint64_t gets     = 0;
+        uint64_t emplaces = 0;
+        uint64_t modifies = 0;
+        uint64_t erases   = 0;
+        uint64_t bytes    = 0;
+    };
+
+    // counts for the executing action keyed by table name, memory is fresh for every action
+    static inline map<uint64_t, op_counts>& counters() {
+        static map<uint64_t, op_counts> counts;
+        return counts;
+    }
+
+    template<name::raw TableName, typename T, typename... Indices>
+    class counted_index : public multi_index<TableName, T, Indices...> {
+        using base = multi_index<TableName, T, Indices...>;
+
+        static op_counts& _counts() { return counters()[static_cast<uint64_t>(TableName)]; }
+
+      public:
+        using base::base;
+        using typename base::const_iterator;
+
+        const_iterator find( uint64_t primary ) const {
+            _counts().finds++;
+            return base::find( primary );
+        }
+
+        const_iterator lower_bound( uint64_t primary ) const {
+            _counts().finds++;
+            return base::lower_bound( primary );
+        }
+
+        const T& get( uint64_t primary, const char* error_msg = "unable to find key" ) const {
+            _counts().gets++;
+            return base::get( primary, error_msg );
+        }
+
+        template<typename Lambda>
+        const_iterator emplace( name payer, Lambda&& constructor ) {
+            auto& counts = _counts();
+            counts.emplaces++;
+            return base::emplace( payer, [&]( auto& obj ) {
+                constructor( obj );
+                counts.bytes += pack_size( obj );
+            });
+        }
+
+        template<typename Lambda>
+        void modify( const_iterator itr, name payer, Lambda&& updater ) {
+            modify( *itr, payer, updater );
+        }
+
+        template<typename Lambda>
+        void modify( const T& obj, name payer, Lambda&& updater ) {
+            auto& counts = _counts();
+            counts.modifies++;
+            base::modify( obj, payer, [&]( auto& o ) {
+                updater( o );
+                counts.bytes += pack_size( o );
+            });
+        }
+
+        const_iterator erase( const_iterator itr ) {
+            _counts().erases++;
+            return base::erase( itr );
+        }
+
+        void erase( const T& obj ) {
+            _counts().erases++;
+            base::erase( obj );
+        }
+    };
+
+    template<name::raw SingletonName, typename T>
+    class counted_singleton : public eosio::singleton<SingletonName, T> {
+        using base = eosio::singleton<SingletonName, T>;
+
+        static op_counts& _counts() { return counters()[static_cast<uint64_t>(SingletonName)]; }
+
+      public:
+        using base::base;
+
+        bool exists() {
+            _counts().finds++;
+            return base::exists();
+        }
+
+        T get() {
+            _counts().gets++;
+            return base::get();
+        }
+
+        T get_or_default( const T& def = T() ) {
+            _counts().gets++;
+            return base::get_or_default( def );
+        }
+
+        T get_or_create( name payer, const T& def = T() ) {
+            _counts().gets++;
+            return base::get_or_create( payer, def );
+        }
+
+        void set( const T& value, name payer ) {
+            auto& counts = _counts();
+            counts.modifies++;
+            counts.bytes += pack_size( value );
+            base::set( value, payer );
+        }
+    };
+
+    template<name::raw TableName, typename T, typename... Indices>
+    inline void walked( const counted_index<TableName, T, Indices...>& ) {
+        counters()[static_cast<uint64_t>(TableName)].finds++;
+    }
+
+    template<name::raw TableName, typename T, typename... Indices>
+    using table = counted_index<TableName, T, Indices...>;
+
+    template<name::raw SingletonName, typename T>
+    using singleton = counted_singleton<SingletonName, T>;
+
+#else
+
+    template<typename Table>
+    inline void walked( const Table& ) {}
+
+    template<name::raw TableName, typename T, typename... Indices>
+    using table = multi_index<TableName, T, Indices...>;
+
+    template<name::raw SingletonName, typename T>
+    using singleton = eosio::singleton<SingletonName, T>;
+
+#endif
+}
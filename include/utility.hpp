@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include <algorithm>
 #include <cctype>
 #include <locale>
@@ -32,18 +33,27 @@ namespace utility {
         return s;
     }
 
-    tuple<uint64_t, name> parsememo(const string& memo) {
+    // memo is batch_id[:batch_id...],to_account
+    tuple<vector<uint64_t>, name> parsememo(const string& memo) {
         auto comma_pos = memo.find(',');
         string errormsg = "malformed memo: must have batch_id,to_account";
         check ( comma_pos != string::npos, errormsg );
         if ( comma_pos != string::npos ) {
             check( ( comma_pos != memo.size() - 1 ), errormsg );
         }
-        // will abort if stoull throws error since wasm no error checking
-        uint64_t batch_id = stoull( trim( memo.substr( 0, comma_pos ) ) );
+        vector<uint64_t> batch_ids;
+        string batch_list = memo.substr( 0, comma_pos );
+        size_t start = 0;
+        while ( true ) {
+            auto colon_pos = batch_list.find( ':', start );
+            // will abort if stoull throws error since wasm no error checking
+            batch_ids.push_back( stoull( trim( batch_list.substr( start, colon_pos - start ) ) ) );
+            if ( colon_pos == string::npos ) break;
+            start = colon_pos + 1;
+        }
         name to_account = name( trim ( memo.substr( comma_pos + 1 ) ) );
 
-        return make_tuple(batch_id, to_account);
+        return make_tuple(batch_ids, to_account);
 
     }
 }
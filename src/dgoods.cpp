@@ -1,6 +1,24 @@
 #include <dgoods.hpp>
 #include <math.h>
 
+// Private, one lower_bound per range then walks the contiguous dgoods instead of a find per id.
+// f is called with an iterator to each dgood and returns the iterator to continue from, so it may
+// modify or erase the row
+template<typename F>
+void dgoods::_walkdgoods(dgood_index& dgood_table, const vector<idrange>& dgood_ranges, F&& f) {
+    for ( auto const& range: dgood_ranges ) {
+        auto itr = dgood_table.lower_bound( range.start_id );
+        for ( uint64_t i = 0; i < range.count; i++ ) {
+            // first row came from lower_bound, the rest are reached by walking
+            if ( i > 0 ) {
+                instrument::walked( dgood_table );
+            }
+            check( itr != dgood_table.end() && itr->id == range.start_id + i, "token does not exist" );
+            itr = f( itr );
+        }
+    }
+}
+
 ACTION dgoods::setconfig(const symbol_code& sym, const string& version) {
 
     require_auth( get_self() );
@@ -56,6 +74,8 @@ ACTION dgoods::create(const name& issuer,
     check(config_table.exists(), "Symbol table does not exist, setconfig first");
     auto config_singleton  = config_table.get();
     auto category_name_id = config_singleton.category_name_id;
+    // category_name_id forms the high bits of every dgood_id minted for this token
+    check( category_name_id <= MAX_CATEGORY_NAME_ID, "max number of category, token_name pairs reached" );
 
 
     category_index category_table( get_self(), get_self().value );
@@ -136,7 +156,7 @@ ACTION dgoods::issue(const name& to,
         asset issued_supply = dgood_stats.issued_supply;
         asset one_token = asset( 1, dgood_stats.max_supply.symbol);
         for ( uint64_t i = 1; i <= quantity.amount; i++ ) {
-            _mint(to, dgood_stats.issuer, category, token_name,
+            _mint(to, dgood_stats.issuer, category, token_name, dgood_stats.category_name_id,
                   issued_supply, relative_uri);
             // used to keep track of serial number when minting multiple
             issued_supply += one_token;
@@ -152,27 +172,40 @@ ACTION dgoods::issue(const name& to,
 }
 
 ACTION dgoods::burnnft(const name& owner,
-                       const vector<uint64_t>& dgood_ids) {
+                       const vector<uint64_t>& dgood_ids,
+                       const binary_extension<vector<idrange>>& dgood_ranges) {
     require_auth(owner);
 
     check( dgood_ids.size() <= 20, "max batch size of 20" );
-    // loop through vector of dgood_ids, check token exists
+    auto ranges = _mergeranges( dgood_ids, dgood_ranges.value_or() );
+
+    // make sure tokens not locked
     lock_index lock_table( get_self(), get_self().value );
-    dgood_index dgood_table( get_self(), get_self().value );
-    for ( auto const& dgood_id: dgood_ids ) {
-        const auto& token = dgood_table.get( dgood_id, "token does not exist" );
-        check( token.owner == owner, "must be token owner" );
+    for ( auto const& range: ranges ) {
+        _checkunlocked( lock_table, range, "token locked" );
+    }
 
-        stats_index stats_table( get_self(), token.category.value );
-        const auto& dgood_stats = stats_table.get( token.token_name.value, "dgood stats not found" );
+    // loop through dgoods, check token exists, count burned per token type
+    stats_cache stats;
+    map<pair<uint64_t, uint64_t>, int64_t> burned;
+    dgood_index dgood_table( get_self(), get_self().value );
+    _walkdgoods( dgood_table, ranges, [&]( auto itr ) {
+        check( itr->owner == owner, "must be token owner" );
 
+        const auto& dgood_stats = _getstats( stats, itr->category, itr->token_name );
         check( dgood_stats.burnable == true, "Not burnable");
         check( dgood_stats.fungible == false, "Cannot call burnnft on fungible token, call burnft instead");
-        // make sure token not locked;
-        auto locked_nft = lock_table.find( dgood_id );
-        check(locked_nft == lock_table.end(), "token locked");
+        burned[make_pair( itr->category.value, itr->token_name.value )]++;
+
+        // erase token
+        return dgood_table.erase( itr );
+    });
+
+    for ( auto const& burn: burned ) {
+        stats_index stats_table( get_self(), burn.first.first );
+        const auto& dgood_stats = stats_table.get( burn.first.second, "dgood stats not found" );
 
-        asset quantity(1, dgood_stats.max_supply.symbol);
+        asset quantity(burn.second, dgood_stats.max_supply.symbol);
         // decrease current supply
         stats_table.modify( dgood_stats, same_payer, [&]( auto& s ) {
             s.current_supply -= quantity;
@@ -180,9 +213,6 @@ ACTION dgoods::burnnft(const name& owner,
 
         // lower balance from owner
         _sub_balance(owner, dgood_stats.category_name_id, quantity);
-
-        // erase token
-        dgood_table.erase( token );
     }
 }
 
@@ -213,7 +243,8 @@ ACTION dgoods::burnft(const name& owner,
 ACTION dgoods::transfernft(const name& from,
                            const name& to,
                            const vector<uint64_t>& dgood_ids,
-                           const string& memo ) {
+                           const string& memo,
+                           const binary_extension<vector<idrange>>& dgood_ranges ) {
 
     check( dgood_ids.size() <= 20, "max batch size of 20" );
     // ensure authorized to send from account
@@ -226,7 +257,8 @@ ACTION dgoods::transfernft(const name& from,
     // check memo size
     check( memo.size() <= 256, "memo has more than 256 bytes" );
 
-    _changeowner( from, to, dgood_ids, memo, true );
+    auto ranges = _mergeranges( dgood_ids, dgood_ranges.value_or() );
+    _changeowner( from, to, ranges, memo, true );
 }
 
 ACTION dgoods::transferft(const name& from,
@@ -261,10 +293,68 @@ ACTION dgoods::transferft(const name& from,
     _add_balance(to, get_self(), category, token_name, dgood_stats.category_name_id, quantity);
 }
 
+ACTION dgoods::transferfts(const name& from,
+                           const name& to,
+                           const vector<ftquantity>& transfers,
+                           const string& memo ) {
+    check( transfers.size() <= 30, "max batch size of 30" );
+    // ensure authorized to send from account
+    check( from != to, "cannot transfer to self" );
+    require_auth( from );
+
+    // ensure 'to' account exists
+    check( is_account( to ), "to account does not exist");
+
+    // check memo size
+    check( memo.size() <= 256, "memo has more than 256 bytes" );
+
+    require_recipient( from );
+    require_recipient( to );
+
+    // symbol is the same for every token, read config once instead of per _checkasset
+    config_index config_table( get_self(), get_self().value );
+    auto config_symbol = config_table.get().symbol;
+
+    account_index from_account( get_self(), from.value );
+    account_index to_account( get_self(), to.value );
+    for ( size_t i = 0; i < transfers.size(); i++ ) {
+        const auto& transfer = transfers[i];
+        const auto& quantity = transfer.quantity;
+        // error message names the offending element, only built on failure
+        auto check_item = [&]( bool pred, const char* msg ) {
+            if ( !pred ) {
+                check( false, "transfers[" + to_string( i ) + "] " + transfer.category.to_string() + ":" +
+                              transfer.token_name.to_string() + ": " + msg );
+            }
+        };
+
+        stats_index stats_table( get_self(), transfer.category.value );
+        auto dgood_stats = stats_table.find( transfer.token_name.value );
+        check_item( dgood_stats != stats_table.end(), "dgood stats not found" );
+        check_item( dgood_stats->transferable == true, "not transferable" );
+        check_item( dgood_stats->fungible == true, "Must be fungible token" );
+
+        check_item( quantity.amount > 0, "amount must be positive" );
+        check_item( config_symbol.raw() == quantity.symbol.code().raw(), "Symbol must match symbol in config" );
+        check_item( quantity.is_valid(), "invalid amount" );
+        if ( quantity.symbol != dgood_stats->max_supply.symbol ) {
+            string string_precision = "precision of quantity must be " + to_string( dgood_stats->max_supply.symbol.precision() );
+            check_item( false, string_precision.c_str() );
+        }
+
+        auto acct = from_account.find( dgood_stats->category_name_id );
+        check_item( acct != from_account.end(), "token does not exist in account" );
+        check_item( acct->amount.amount >= quantity.amount, "quantity is more than account balance" );
+        _sub_balance( from_account, *acct, quantity );
+        _add_balance( to_account, get_self(), transfer.category, transfer.token_name, dgood_stats->category_name_id, quantity );
+    }
+}
+
 ACTION dgoods::listsalenft(const name& seller,
                            const vector<uint64_t>& dgood_ids,
                            const uint32_t sell_by_days,
-                           const asset& net_sale_amount) {
+                           const asset& net_sale_amount,
+                           const binary_extension<vector<idrange>>& dgood_ranges) {
     require_auth( seller );
 
     time_point_sec expiration = time_point_sec(0);
@@ -278,36 +368,51 @@ ACTION dgoods::listsalenft(const name& seller,
     check( net_sale_amount.amount > .02 * pow(10, net_sale_amount.symbol.precision()), "minimum price of at least 0.02 EOS");
     check( net_sale_amount.symbol == symbol( symbol_code("EOS"), 4), "only accept EOS for sale" );
 
-    dgood_index dgood_table( get_self(), get_self().value );
-    for ( auto const& dgood_id: dgood_ids ) {
-        const auto& token = dgood_table.get( dgood_id, "token does not exist" );
+    auto ranges = _mergeranges( dgood_ids, dgood_ranges.value_or() );
+    check( !ranges.empty(), "must list at least one dgood" );
 
-        stats_index stats_table( get_self(), token.category.value );
-        const auto& dgood_stats = stats_table.get( token.token_name.value, "dgood stats not found" );
+    // make sure tokens not locked
+    lock_index lock_table( get_self(), get_self().value );
+    for ( auto const& range: ranges ) {
+        _checkunlocked( lock_table, range, "token locked" );
+    }
 
-        check( dgood_stats.sellable == true, "not sellable");
-        check ( seller == token.owner, "not token owner");
+    // collection of the listing, stays 0 if the batch spans more than one collection
+    uint64_t category_name_id = 0;
+    bool first_token = true;
+    stats_cache stats;
+    dgood_index dgood_table( get_self(), get_self().value );
+    _walkdgoods( dgood_table, ranges, [&]( auto itr ) {
+        const auto& dgood_stats = _getstats( stats, itr->category, itr->token_name );
+
+        if ( first_token ) {
+            category_name_id = dgood_stats.category_name_id;
+            first_token = false;
+        } else if ( category_name_id != dgood_stats.category_name_id ) {
+            category_name_id = 0;
+        }
 
-        // make sure token not locked;
-        lock_index lock_table( get_self(), get_self().value );
-        auto locked_nft = lock_table.find( dgood_id );
-        check(locked_nft == lock_table.end(), "token locked");
+        check( dgood_stats.sellable == true, "not sellable");
+        check ( seller == itr->owner, "not token owner");
 
         // add token to lock table
         lock_table.emplace( seller, [&]( auto& l ) {
-            l.dgood_id = dgood_id;
+            l.dgood_id = itr->id;
         });
-    }
+        return ++itr;
+    });
 
     ask_index ask_table( get_self(), get_self().value );
-    // add batch to table of asks
+    // add batch to table of asks, ids are stored as merged ranges, dgood_ids is only set on
+    // asks listed before ranges were added
     // set id to the first dgood being listed, if only one being listed, simplifies life
     ask_table.emplace( seller, [&]( auto& a ) {
-        a.batch_id = dgood_ids[0];
-        a.dgood_ids = dgood_ids;
+        a.batch_id = ranges[0].start_id;
         a.seller = seller;
         a.amount = net_sale_amount;
         a.expiration = expiration;
+        a.category_name_id.emplace( category_name_id );
+        a.dgood_ranges.emplace( ranges );
     });
 }
 
@@ -322,10 +427,7 @@ ACTION dgoods::closesalenft(const name& seller,
         check( ask.seller == seller, "only the seller can cancel a sale in progress");
     }
     // sale has expired anyone can call this and ask removed, token removed from asks/lock
-    for ( auto const& dgood_id: ask.dgood_ids ) {
-        const auto& locked_nft = lock_table.get( dgood_id, "dgood not found in lock table" );
-        lock_table.erase( locked_nft );
-    }
+    _unlock( lock_table, _mergeranges( ask.dgood_ids, ask.dgood_ranges.value_or() ) );
     ask_table.erase( ask );
 }
 
@@ -339,49 +441,101 @@ void dgoods::buynft(const name& from,
     if ( to != get_self() ) return;
     if ( from == name("eosio.stake") ) return;
     check( quantity.symbol == symbol( symbol_code("EOS"), 4), "Buy only with EOS" );
-    check( memo.length() <= 32, "memo too long" );
+    check( memo.length() <= 256, "memo too long" );
 
-    //memo format comma separated
-    //batch_id,to_account
-    uint64_t batch_id;
+    //memo format comma separated, several listings may be bought at once separated by colons
+    //batch_id[:batch_id...],to_account
+    vector<uint64_t> batch_ids;
     name to_account;
-    tie( batch_id, to_account ) = parsememo(memo);
+    tie( batch_ids, to_account ) = parsememo(memo);
+    check( batch_ids.size() <= 16, "max cart size of 16 listings" );
 
     ask_index ask_table( get_self(), get_self().value );
-    const auto& ask = ask_table.get( batch_id, "cannot find listing" );
-    check ( ask.amount.amount == quantity.amount, "send the correct amount");
-    check ( ask.expiration == time_point_sec(0) || ask.expiration > time_point_sec(current_time_point()), "sale has expired");
+    lock_index lock_table( get_self(), get_self().value );
+
+    // amounts owed across every listing in the cart, sellers are paid inline while rev_partner
+    // fees accrue in the royalties ledger until withdrawn
+    map<name, asset> seller_map;
+    map<name, asset> royalty_map;
+    vector<cartlisting> listings;
+    // asset addition checks for overflow, 16 asks near the max amount would overflow an int64_t
+    asset total_amount( 0, quantity.symbol );
+    for ( auto const& batch_id: batch_ids ) {
+        // a repeated batch_id fails here since the ask was already erased
+        const auto& ask = ask_table.get( batch_id, "cannot find listing" );
+        check ( ask.expiration == time_point_sec(0) || ask.expiration > time_point_sec(current_time_point()), "sale has expired");
+        total_amount += ask.amount;
+
+        auto ranges = _mergeranges( ask.dgood_ids, ask.dgood_ranges.value_or() );
+
+        // nft(s) bought, change owner to buyer regardless of transferable
+        _changeowner( ask.seller, to_account, ranges, "bought by: " + to_account.to_string(), false);
+
+        for ( auto const& fee : _calcfees(ranges, ask.amount, ask.seller) ) {
+            auto& owed_map = fee.first == ask.seller ? seller_map : royalty_map;
+            auto ret_val = owed_map.insert( fee );
+            if ( ret_val.second == false ) {
+                owed_map[fee.first] += fee.second;
+            }
+        }
 
-    // nft(s) bought, change owner to buyer regardless of transferable
-    _changeowner( ask.seller, to_account, ask.dgood_ids, "bought by: " + to_account.to_string(), false);
+        // remove locks
+        _unlock( lock_table, ranges );
+        listings.push_back( cartlisting{ batch_id, ask.seller, ask.amount, ranges } );
 
-    // amounts owed to all parties
-    map<name, asset> fee_map = _calcfees(ask.dgood_ids, ask.amount, ask.seller);
-    for(auto const& fee : fee_map) {
-        auto account = fee.first;
-        auto amount = fee.second;
+        // remove sale listing
+        ask_table.erase( ask );
+    }
+    check ( total_amount == quantity, "send the correct amount");
 
+    // one payout per seller, no matter how many listings it was owed for
+    for ( auto const& fee : seller_map ) {
         // if seller is contract, no need to send EOS again
-        if ( account != get_self() ) {
-            // send EOS to account owed
-            action( permission_level{ get_self(), name("active") },
-                    name("eosio.token"), name("transfer"),
-                    make_tuple( get_self(), account, amount, string("sale of dgood") ) ).send();
+        if ( fee.first != get_self() ) {
+            _sendeos( fee.first, fee.second, "sale of dgood" );
         }
     }
 
-    // remove locks, remove from ask table
-    lock_index lock_table( get_self(), get_self().value );
+    royaltyconf_index royaltyconf_table( get_self(), get_self().value );
+    auto flush_threshold = royaltyconf_table.get_or_default( royaltyconf{ asset( 0, quantity.symbol ) } ).flush_threshold;
+    for ( auto const& fee : royalty_map ) {
+        // _calcfees truncates small shares to 0, a zero row could never be withdrawn
+        if ( fee.first != get_self() && fee.second.amount > 0 ) {
+            _creditroyalty( fee.first, fee.second, flush_threshold );
+        }
+    }
 
-    for ( auto const& dgood_id: ask.dgood_ids ) {
-        const auto& locked_nft = lock_table.get( dgood_id, "dgood not found in lock table" );
-        lock_table.erase( locked_nft );
+    if ( listings.size() == 1 ) {
+        vector<uint64_t> dgood_ids;
+        for ( auto const& range: listings[0].dgood_ranges ) {
+            for ( uint64_t i = 0; i < range.count; i++ ) {
+                dgood_ids.push_back( range.start_id + i );
+            }
+        }
+        SEND_INLINE_ACTION( *this, logsale, { { get_self(), "active"_n } }, { dgood_ids, listings[0].seller, from, to_account } );
+    } else {
+        SEND_INLINE_ACTION( *this, logcartsale, { { get_self(), "active"_n } }, { listings, from, to_account } );
     }
+}
 
-    SEND_INLINE_ACTION( *this, logsale, { { get_self(), "active"_n } }, { ask.dgood_ids, ask.seller, from, to_account } );
+ACTION dgoods::withdraw(const name& rev_partner) {
+    require_auth( rev_partner );
 
-    // remove sale listing
-    ask_table.erase( ask );
+    royalty_index royalty_table( get_self(), get_self().value );
+    const auto& royalty = royalty_table.get( rev_partner.value, "no royalties owed" );
+    check( royalty.balance.amount > 0, "no royalties owed" );
+    _sendeos( rev_partner, royalty.balance, "dgood royalties" );
+    royalty_table.erase( royalty );
+}
+
+ACTION dgoods::setroyflush(const asset& flush_threshold) {
+    require_auth( get_self() );
+    check( flush_threshold.symbol == symbol( symbol_code("EOS"), 4), "threshold must be in EOS" );
+    check( flush_threshold.amount >= 0, "threshold must be 0 or greater" );
+
+    // 0 disables auto flush, royalties are then only paid out by withdraw
+    royaltyconf_index royaltyconf_table( get_self(), get_self().value );
+    royaltyconf_table.set( royaltyconf{ flush_threshold }, get_self() );
 }
 
 // method to log dgood_id and match transaction to action
@@ -394,6 +548,11 @@ ACTION dgoods::logsale(const vector<uint64_t>& dgood_ids, const name& seller, co
     require_auth( get_self() );
 }
 
+// method to log a successful multi listing sale, one entry per listing bought
+ACTION dgoods::logcartsale(const vector<cartlisting>& listings, const name& buyer, const name& receiver) {
+    require_auth( get_self() );
+}
+
 ACTION dgoods::freezemaxsup(const name& category, const name& token_name) {
     require_auth( get_self() );
 
@@ -409,30 +568,68 @@ ACTION dgoods::freezemaxsup(const name& category, const name& token_name) {
     });
 }
 
+#ifdef DGOODS_INSTRUMENT
+// accumulate this action's table operation counts, called from apply once the action has run
+void dgoods::logopstats(const name& action) {
+    opstats_index opstats_table( get_self(), action.value );
+    for ( auto const& entry: instrument::counters() ) {
+        auto table = name( entry.first );
+        auto const& counts = entry.second;
+        auto existing = opstats_table.find( table.value );
+        if ( existing == opstats_table.end() ) {
+            opstats_table.emplace( get_self(), [&]( auto& s ) {
+                s.table = table;
+                s.calls = 1;
+                s.finds = counts.finds;
+                s.gets = counts.gets;
+                s.emplaces = counts.emplaces;
+                s.modifies = counts.modifies;
+                s.erases = counts.erases;
+                s.bytes = counts.bytes;
+            });
+        } else {
+            opstats_table.modify( existing, same_payer, [&]( auto& s ) {
+                s.calls++;
+                s.finds += counts.finds;
+                s.gets += counts.gets;
+                s.emplaces += counts.emplaces;
+                s.modifies += counts.modifies;
+                s.erases += counts.erases;
+                s.bytes += counts.bytes;
+            });
+        }
+    }
+}
+#endif
+
 // Private
-map<name, asset> dgoods::_calcfees(vector<uint64_t> dgood_ids, asset ask_amount, name seller) {
+map<name, asset> dgoods::_calcfees(const vector<idrange>& dgood_ranges, asset ask_amount, name seller) {
     map<name, asset> fee_map;
+    uint64_t dgood_count = 0;
+    for ( auto const& range: dgood_ranges ) {
+        dgood_count += range.count;
+    }
+
+    stats_cache stats;
     dgood_index dgood_table( get_self(), get_self().value );
     int64_t tot_fees = 0;
-    for ( auto const& dgood_id: dgood_ids ) {
-        const auto& token = dgood_table.get( dgood_id, "token does not exist" );
-
-        stats_index stats_table( get_self(), token.category.value );
-        const auto& dgood_stats = stats_table.get( token.token_name.value, "dgood stats not found" );
+    _walkdgoods( dgood_table, dgood_ranges, [&]( auto itr ) {
+        const auto& dgood_stats = _getstats( stats, itr->category, itr->token_name );
 
         name rev_partner = dgood_stats.rev_partner;
         if ( dgood_stats.rev_split == 0.0 ) {
-            continue;
+            return ++itr;
         }
 
-        double fee = static_cast<double>(ask_amount.amount) * dgood_stats.rev_split / static_cast<double>( dgood_ids.size() );
+        double fee = static_cast<double>(ask_amount.amount) * dgood_stats.rev_split / static_cast<double>( dgood_count );
         asset fee_asset(fee, ask_amount.symbol);
         auto ret_val = fee_map.insert({rev_partner, fee_asset});
         tot_fees += fee_asset.amount;
         if ( ret_val.second == false ) {
             fee_map[rev_partner] += fee_asset;
         }
-    }
+        return ++itr;
+    });
     //add seller to fee_map minus fees
     asset seller_amount(ask_amount.amount - tot_fees, ask_amount.symbol);
     auto ret_val = fee_map.insert({seller, seller_amount});
@@ -443,36 +640,132 @@ map<name, asset> dgoods::_calcfees(vector<uint64_t> dgood_ids, asset ask_amount,
 }
 
 // Private
-void dgoods::_changeowner(const name& from, const name& to, const vector<uint64_t>& dgood_ids, const string& memo, const bool& istransfer) {
-    check (dgood_ids.size() <= 20, "max batch size of 20");
-    // loop through vector of dgood_ids, check token exists
+void dgoods::_creditroyalty(const name& rev_partner, const asset& amount, const asset& flush_threshold) {
+    royalty_index royalty_table( get_self(), get_self().value );
+    auto royalty = royalty_table.find( rev_partner.value );
+    asset balance = amount;
+    if ( royalty != royalty_table.end() ) {
+        balance += royalty->balance;
+    }
+
+    // pay out immediately once the balance reaches the auto flush threshold
+    if ( flush_threshold.amount > 0 && balance >= flush_threshold ) {
+        _sendeos( rev_partner, balance, "dgood royalties" );
+        if ( royalty != royalty_table.end() ) {
+            royalty_table.erase( royalty );
+        }
+    } else if ( royalty == royalty_table.end() ) {
+        royalty_table.emplace( get_self(), [&]( auto& r ) {
+            r.rev_partner = rev_partner;
+            r.balance = balance;
+        });
+    } else {
+        royalty_table.modify( royalty, same_payer, [&]( auto& r ) {
+            r.balance = balance;
+        });
+    }
+}
+
+// Private
+void dgoods::_sendeos(const name& to, const asset& amount, const string& memo) {
+    action( permission_level{ get_self(), name("active") },
+            name("eosio.token"), name("transfer"),
+            make_tuple( get_self(), to, amount, memo ) ).send();
+}
+
+// Private
+void dgoods::_changeowner(const name& from, const name& to, const vector<idrange>& dgood_ranges, const string& memo, const bool& istransfer) {
+    // notifiy both parties
+    require_recipient( from );
+    require_recipient( to );
+
     dgood_index dgood_table( get_self(), get_self().value );
     lock_index lock_table( get_self(), get_self().value );
-    for ( auto const& dgood_id: dgood_ids ) {
-        const auto& token = dgood_table.get( dgood_id, "token does not exist" );
+    if ( istransfer ) {
+        for ( auto const& range: dgood_ranges ) {
+            _checkunlocked( lock_table, range, "token locked, cannot transfer" );
+        }
+    }
 
-        stats_index stats_table( get_self(), token.category.value );
-        const auto& dgood_stats = stats_table.get( token.token_name.value, "dgood stats not found" );
+    // loop through dgoods, check token exists, count moved per token type
+    stats_cache stats;
+    map<pair<uint64_t, uint64_t>, int64_t> moved;
+    _walkdgoods( dgood_table, dgood_ranges, [&]( auto itr ) {
+        const auto& dgood_stats = _getstats( stats, itr->category, itr->token_name );
 
         if ( istransfer ) {
-            check( token.owner == from, "must be token owner" );
+            check( itr->owner == from, "must be token owner" );
             check( dgood_stats.transferable == true, "not transferable");
-            auto locked_nft = lock_table.find( dgood_id );
-            check( locked_nft == lock_table.end(), "token locked, cannot transfer");
         }
 
-        // notifiy both parties
-        require_recipient( from );
-        require_recipient( to );
-        dgood_table.modify( token, same_payer, [&] (auto& t ) {
+        moved[make_pair( itr->category.value, itr->token_name.value )]++;
+        dgood_table.modify( itr, same_payer, [&] (auto& t ) {
             t.owner = to;
         });
+        return ++itr;
+    });
 
-        // amount 1, precision 0 for NFT
-        asset quantity(1, dgood_stats.max_supply.symbol);
+    // balances change once per token type rather than once per dgood
+    for ( auto const& move: moved ) {
+        const auto& dgood_stats = stats[move.first];
+        asset quantity(move.second, dgood_stats.max_supply.symbol);
         _sub_balance(from, dgood_stats.category_name_id, quantity);
-        _add_balance(to, get_self(), token.category, token.token_name, dgood_stats.category_name_id, quantity);
+        _add_balance(to, get_self(), name(move.first.first), name(move.first.second), dgood_stats.category_name_id, quantity);
+    }
+}
+
+// Private, merges a list of dgood_ids into contiguous ranges followed by the given ranges
+vector<idrange> dgoods::_mergeranges(const vector<uint64_t>& dgood_ids, const vector<idrange>& dgood_ranges) {
+    vector<idrange> ranges;
+    for ( auto const& dgood_id: dgood_ids ) {
+        if ( !ranges.empty() && ranges.back().start_id + ranges.back().count == dgood_id ) {
+            ranges.back().count++;
+        } else {
+            ranges.push_back( idrange{ dgood_id, 1 } );
+        }
+    }
+
+    uint64_t dgood_count = dgood_ids.size();
+    for ( auto const& range: dgood_ranges ) {
+        check( range.count >= 1 && range.count <= 100, "range count must be between 1 and 100" );
+        check( range.start_id <= numeric_limits<uint64_t>::max() - range.count, "range exceeds max dgood_id" );
+        dgood_count += range.count;
+        ranges.push_back( range );
     }
+    check( dgood_count <= 100, "max batch size of 100" );
+    return ranges;
+}
+
+// Private, one lower_bound checks the whole range instead of a find per dgood
+void dgoods::_checkunlocked(lock_index& lock_table, const idrange& range, const char* error_msg) {
+    auto locked_nft = lock_table.lower_bound( range.start_id );
+    check( locked_nft == lock_table.end() || locked_nft->dgood_id - range.start_id >= range.count, error_msg );
+}
+
+// Private
+void dgoods::_unlock(lock_index& lock_table, const vector<idrange>& dgood_ranges) {
+    for ( auto const& range: dgood_ranges ) {
+        auto locked_nft = lock_table.lower_bound( range.start_id );
+        for ( uint64_t i = 0; i < range.count; i++ ) {
+            if ( i > 0 ) {
+                instrument::walked( lock_table );
+            }
+            check( locked_nft != lock_table.end() && locked_nft->dgood_id == range.start_id + i,
+                   "dgood not found in lock table" );
+            locked_nft = lock_table.erase( locked_nft );
+        }
+    }
+}
+
+// Private, stats of consecutive dgoods are usually the same so only read each type once
+const dgoods::dgoodstats& dgoods::_getstats(stats_cache& stats, const name& category, const name& token_name) {
+    auto key = make_pair( category.value, token_name.value );
+    auto cached = stats.find( key );
+    if ( cached == stats.end() ) {
+        stats_index stats_table( get_self(), category.value );
+        cached = stats.emplace( key, stats_table.get( token_name.value, "dgood stats not found" ) ).first;
+    }
+    return cached->second;
 }
 
 // Private
@@ -496,15 +789,17 @@ void dgoods::_mint(const name& to,
                    const name& issuer,
                    const name& category,
                    const name& token_name,
+                   const uint64_t& category_name_id,
                    const asset& issued_supply,
                    const string& relative_uri) {
 
     dgood_index dgood_table( get_self(), get_self().value);
-    auto dgood_id = _nextdgoodid();
+    uint64_t serial_number = issued_supply.amount + 1;
+    auto dgood_id = _dgoodid( category_name_id, serial_number );
     if ( relative_uri.empty() ) {
         dgood_table.emplace( issuer, [&]( auto& dg) {
             dg.id = dgood_id;
-            dg.serial_number = issued_supply.amount + 1;
+            dg.serial_number = serial_number;
             dg.owner = to;
             dg.category = category;
             dg.token_name = token_name;
@@ -512,7 +807,7 @@ void dgoods::_mint(const name& to,
     } else {
         dgood_table.emplace( issuer, [&]( auto& dg ) {
             dg.id = dgood_id;
-            dg.serial_number = issued_supply.amount + 1;
+            dg.serial_number = serial_number;
             dg.owner = to;
             dg.category = category;
             dg.token_name = token_name;
@@ -523,21 +818,27 @@ void dgoods::_mint(const name& to,
 }
 
 // available_primary_key() will reuise id's if last minted token is burned -- bad
-uint64_t dgoods::_nextdgoodid() {
-
-    // get next_dgood_id and increment
-    config_index config_table( get_self(), get_self().value );
-    check(config_table.exists(), "dgoods config table does not exist, setconfig first");
-    auto config_singleton  = config_table.get();
-    auto next_dgood_id = config_singleton.next_dgood_id++;
-    config_table.set( config_singleton, _self );
-    return next_dgood_id;
+// id is category_name_id in the high bits, serial_number in the low bits. serial_number never
+// repeats since issued_supply never decreases, and minting no longer writes the tokenconfigs row.
+// category_name_id starts at 1 so ids never collide with ones from the old global counter, a
+// category_name_id of 0 is rejected since its ids would overlap them.
+uint64_t dgoods::_dgoodid(const uint64_t& category_name_id, const uint64_t& serial_number) {
+    check( category_name_id > 0, "category_name_id 0 would collide with legacy dgood_ids" );
+    check( category_name_id <= MAX_CATEGORY_NAME_ID, "category_name_id exceeds dgood_id range" );
+    check( serial_number <= MAX_SERIAL_NUMBER, "serial number exceeds dgood_id range" );
+    return ( category_name_id << SERIAL_NUMBER_BITS ) | serial_number;
 }
 
 // Private
 void dgoods::_add_balance(const name& owner, const name& ram_payer, const name& category, const name& token_name,
                          const uint64_t& category_name_id, const asset& quantity) {
     account_index to_account( get_self(), owner.value );
+    _add_balance(to_account, ram_payer, category, token_name, category_name_id, quantity);
+}
+
+// Private
+void dgoods::_add_balance(account_index& to_account, const name& ram_payer, const name& category, const name& token_name,
+                         const uint64_t& category_name_id, const asset& quantity) {
     auto acct = to_account.find( category_name_id );
     if ( acct == to_account.end() ) {
         to_account.emplace( ram_payer, [&]( auto& a ) {
@@ -559,7 +860,11 @@ void dgoods::_sub_balance(const name& owner, const uint64_t& category_name_id, c
     account_index from_account( get_self(), owner.value );
     const auto& acct = from_account.get( category_name_id, "token does not exist in account" );
     check( acct.amount.amount >= quantity.amount, "quantity is more than account balance");
+    _sub_balance(from_account, acct, quantity);
+}
 
+// Private, caller checks the balance covers quantity
+void dgoods::_sub_balance(account_index& from_account, const accounts& acct, const asset& quantity) {
     if ( acct.amount.amount == quantity.amount ) {
         from_account.erase( acct );
     } else {
@@ -575,13 +880,19 @@ extern "C" {
 
         if ( code == self ) {
             switch( action ) {
-                EOSIO_DISPATCH_HELPER( dgoods, (setconfig)(create)(issue)(burnnft)(burnft)(transfernft)(transferft)(listsalenft)(closesalenft)(logcall)(freezemaxsup) )
+                EOSIO_DISPATCH_HELPER( dgoods, (setconfig)(create)(issue)(burnnft)(burnft)(transfernft)(transferft)(transferfts)(listsalenft)(closesalenft)(withdraw)(setroyflush)(logcall)(logcartsale)(freezemaxsup) )
             }
+#ifdef DGOODS_INSTRUMENT
+            dgoods( name(receiver), name(code), datastream<const char*>(nullptr, 0) ).logopstats( name(action) );
+#endif
         }
 
         else {
             if ( code == name("eosio.token").value && action == name("transfer").value ) {
                 execute_action( name(receiver), name(code), &dgoods::buynft );
+#ifdef DGOODS_INSTRUMENT
+                dgoods( name(receiver), name(code), datastream<const char*>(nullptr, 0) ).logopstats( name("buynft") );
+#endif
             }
         }
     }